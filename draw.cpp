@@ -12,20 +12,24 @@
 // <http://creativecommons.org/publicdomain/zero/1.0/>.
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
 #include <initializer_list>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <list>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -46,6 +50,184 @@ namespace {
     template<typename... Fs>
     MultiLambda(Fs...) -> MultiLambda<Fs...>;
 
+    // The number of bit-planes needed to store any of a palette's inks (each
+    // of which is an index into the palette). Palettes have 2, 4, or 8 symbols.
+    [[nodiscard]] std::size_t depth_for_palette(const std::size_t symbols)
+    {
+        switch (symbols) {
+        case 2u:
+            return 1u;
+
+        case 4u:
+            return 2u;
+
+        case 8u:
+            return 3u;
+
+        default:
+            throw std::length_error{"palette needs 2, 4, or 8 symbols"};
+        }
+    }
+
+    // A row of cells, each holding an ink, which is a palette index. Ink 0 is
+    // the background, so cells holding it are blank. The inks are stored as
+    // bit-planes: plane k packs bit k of every cell's ink into words. So each
+    // cell costs log2 of the palette size in bits, and spans of cells can be
+    // painted, tested, and shifted a whole word at a time.
+    class Row {
+    public:
+        // Constructs a blank row of the given width with the given number of
+        // bit-planes.
+        Row(std::size_t width, std::size_t depth);
+
+        // The ink in the cell at the given x-coordinate.
+        [[nodiscard]] std::size_t ink(std::size_t x) const noexcept;
+
+        // Tells if every cell is blank.
+        [[nodiscard]] bool blank() const noexcept;
+
+        // Puts an ink in the cells from one x-coordinate to another, inclusive.
+        void paint(std::size_t first, std::size_t last,
+                   std::size_t ink) noexcept;
+
+        // Moves the cells the given number of columns west. Cells moved past
+        // the west edge are lost, and blank cells come in at the east edge.
+        void shift_west(std::size_t count) noexcept;
+
+        // Moves the cells the given number of columns east. Cells moved past
+        // the east edge are lost, and blank cells come in at the west edge.
+        void shift_east(std::size_t count) noexcept;
+
+        // Changes the number of bit-planes. Cells whose inks need a removed
+        // plane keep some other nonzero ink, so marked cells stay marked.
+        void set_depth(std::size_t depth);
+
+    private:
+        using Word = std::uint64_t;
+
+        static constexpr std::size_t word_bits {64u};
+
+        // The number of words in each bit-plane.
+        [[nodiscard]] std::size_t span() const noexcept;
+
+        // The width of the row, in cells. Bits past this are always zero.
+        std::size_t width_;
+
+        // The number of bit-planes.
+        std::size_t depth_;
+
+        // The bit-planes, one after another. Bit x of a plane (counting from
+        // the low bit of its first word) is for the cell at x-coordinate x.
+        std::vector<Word> words_;
+    };
+
+    Row::Row(const std::size_t width, const std::size_t depth)
+        : width_{width}, depth_{depth}, words_(depth * span())
+    {
+    }
+
+    std::size_t Row::ink(const std::size_t x) const noexcept
+    {
+        const auto word = x / word_bits, bit = x % word_bits;
+        std::size_t ink {0u};
+
+        for (std::size_t k {0u}; k != depth_; ++k)
+            ink |= ((words_.at(k * span() + word) >> bit) & 1u) << k;
+
+        return ink;
+    }
+
+    bool Row::blank() const noexcept
+    {
+        return std::all_of(cbegin(words_), cend(words_),
+                           [](const Word word) { return word == 0u; });
+    }
+
+    void Row::paint(const std::size_t first, const std::size_t last,
+                    const std::size_t ink) noexcept
+    {
+        assert(first <= last && last < width_);
+
+        const auto first_word = first / word_bits, last_word = last / word_bits;
+
+        for (std::size_t k {0u}; k != depth_; ++k) {
+            const auto set = ((ink >> k) & 1u) != 0u;
+
+            for (auto w = first_word; w <= last_word; ++w) {
+                auto mask = ~Word{0u};
+                if (w == first_word) mask &= mask << (first % word_bits);
+                if (w == last_word)
+                    mask &= ~Word{0u} >> (word_bits - 1u - last % word_bits);
+
+                auto& word = words_.at(k * span() + w);
+                if (set)
+                    word |= mask;
+                else
+                    word &= ~mask;
+            }
+        }
+    }
+
+    void Row::shift_west(const std::size_t count) noexcept
+    {
+        const auto n = span();
+        const auto skip = count / word_bits, bits = count % word_bits;
+
+        for (std::size_t k {0u}; k != depth_; ++k) {
+            const auto plane = k * n;
+
+            // Each word only takes bits from itself and later words.
+            for (std::size_t w {0u}; w != n; ++w) {
+                const auto from = w + skip;
+                Word word {from < n ? words_[plane + from] >> bits : 0u};
+                if (bits != 0u && from + 1u < n)
+                    word |= words_[plane + from + 1u] << (word_bits - bits);
+                words_[plane + w] = word;
+            }
+        }
+    }
+
+    void Row::shift_east(const std::size_t count) noexcept
+    {
+        const auto n = span();
+        const auto skip = count / word_bits, bits = count % word_bits;
+        const auto tail = width_ % word_bits;
+
+        for (std::size_t k {0u}; k != depth_; ++k) {
+            const auto plane = k * n;
+
+            // Each word only takes bits from itself and earlier words.
+            for (auto w = n; w-- != 0u; ) {
+                Word word {w >= skip ? words_[plane + w - skip] << bits : 0u};
+                if (bits != 0u && w >= skip + 1u)
+                    word |= words_[plane + w - skip - 1u] >> (word_bits - bits);
+                words_[plane + w] = word;
+            }
+
+            // Clear the bits that were shifted past the east edge.
+            if (tail != 0u && n != 0u)
+                words_[plane + n - 1u] &= ~(~Word{0u} << tail);
+        }
+    }
+
+    void Row::set_depth(const std::size_t depth)
+    {
+        const auto n = span();
+
+        for (auto k = depth; k < depth_; ++k) {
+            for (std::size_t w {0u}; w != n; ++w)
+                words_[w] |= words_[k * n + w];
+        }
+
+        words_.resize(depth * n);
+        depth_ = depth;
+    }
+
+    inline std::size_t Row::span() const noexcept
+    {
+        return (width_ + word_bits - 1u) / word_bits;
+    }
+
     // A text-based canvas that expands vertically and truncates horizontally.
     class Canvas {
     public:
@@ -53,11 +235,17 @@ namespace {
         // it is moved in any direction while down.
         enum class Pen : bool { up, down };
 
-        // Constructs a canvas with the specified width (in columns), background
-        // symbol, foreground symbol, current position / cursor sumbol, and pen
-        // state (up or down).
-        explicit Canvas(std::size_t width = 70u, char bg = ' ', char fg = '*',
-                        char cur = 'X', Pen pen = Pen::up);
+        // Viewport behavior. A centered viewport keeps the cursor in its middle
+        // row (where possible). A following viewport stays put until the cursor
+        // leaves it, then scrolls just far enough to bring the cursor back in.
+        enum class Scroll : bool { center, follow };
+
+        // Constructs a canvas with the specified width (in columns), palette
+        // (a background symbol followed by 1, 3, or 7 ink symbols), current
+        // position / cursor sumbol, and pen state (up or down).
+        explicit Canvas(std::size_t width = 70u,
+                        std::string_view palette = " *", char cur = 'X',
+                        Pen pen = Pen::up);
 
         // INSTRUCTIONS:                                               NAMES:
 
@@ -106,8 +294,43 @@ namespace {
         // Shortens the canvas by removing empty upper and lower rows.
         void trim() noexcept;                                       // t
 
+        // Moves the pen dx columns east and dy rows south (negative for west
+        // and north) in a straight line of single steps, some diagonal.
+        void line(int dx, int dy);                                  // v
+
+        // Moves the pen around the edges of a rectangle whose opposite corner
+        // is dx columns east and dy rows south, back to where it started.
+        void rectangle(int dx, int dy);                             // r
+
+        // Moves the pen back and forth across each row of such a rectangle,
+        // then back to where it started along the rectangle's edges.
+        void block(int dx, int dy);                                 // x
+
+        // Marks every unmarked cell reachable from the current position by
+        // north, south, east, and west steps through unmarked cells.
+        void fill();                                                // f
+
+        // Selects the ink to mark with: a palette index, clamped to the
+        // palette. Ink 0 is the background, which makes marking erase.
+        void ink(int number) noexcept;                              // p
+
         // ^^^ END OF INSTRUCTIONS ^^^
 
+        // Limits display to a viewport of the given number of rows, or lifts
+        // the limit if the number is zero. (Does not affect draw_all.)
+        void set_viewport(std::size_t height, Scroll scroll) noexcept;
+
+        // Moves the viewport, if need be, after the cursor has moved.
+        void scroll_viewport() noexcept;
+
+        // Draws every row, including any that are outside the viewport.
+        void draw_all(std::ostream& out) const;
+
+        // Switches to another palette (a background symbol followed by 1, 3,
+        // or 7 ink symbols). Cells whose inks are past the end of the new
+        // palette are given other inks, but stay marked.
+        void set_palette(std::string_view palette);
+
         friend std::ostream& operator<<(std::ostream& out,
                                         const Canvas& canvas);
 
@@ -117,18 +340,12 @@ namespace {
         // occurs when an exception would propogate out of a noexcept function,
         // is the least bad of all possible behaviors in such a situation.
 
-        // The cell at the given coordinates (for reading).
+        // The ink in the cell at the given coordinates.
         [[nodiscard]]
-        const bool& cell(std::size_t x, std::size_t y) const noexcept;
-
-        // The cell at the given coordinates (for reading or writing).
-        [[nodiscard]] bool& cell(std::size_t x, std::size_t y) noexcept;
+        std::size_t cell(std::size_t x, std::size_t y) const noexcept;
 
-        // The cell at the current position (for reading).
-        [[nodiscard, maybe_unused]] const bool& here() const noexcept;
-
-        // The cell at the current position (for reading or writing).
-        [[nodiscard]] bool& here() noexcept;
+        // The ink in the cell at the current position.
+        [[nodiscard]] std::size_t here() const noexcept;
 
         // The symbolic representation for the cell at the given coordinates.
         [[nodiscard]] char peek(std::size_t x, std::size_t y) const noexcept;
@@ -145,6 +362,36 @@ namespace {
         // Moves west, but does not call any updaters.
         void move_west();
 
+        // Moves by an offset, as by single steps, and marks the cells stepped
+        // on if the pen is down. Unlike line(), accepts any offset of ints.
+        void travel(std::ptrdiff_t dx, std::ptrdiff_t dy);
+
+        // Grows and pans the canvas as moving by an offset one step at a time
+        // would, but without moving the cursor. Returns the cursor position in
+        // the new coordinates, which is west or east of the canvas if the
+        // column it is in was panned out of view.
+        [[nodiscard]] std::tuple<std::ptrdiff_t, std::ptrdiff_t>
+        make_room(std::ptrdiff_t dx, std::ptrdiff_t dy);
+
+        // Marks the cells stepped on when moving in a line by an offset from
+        // the given position (not counting that position itself). Cells that
+        // are off the canvas are skipped.
+        void trace(std::ptrdiff_t x, std::ptrdiff_t y,
+                   std::ptrdiff_t dx, std::ptrdiff_t dy) noexcept;
+
+        // Puts an ink in the cells of a row from one column to another,
+        // inclusive.
+        void paint_span(std::size_t y, std::size_t first, std::size_t last,
+                        std::size_t ink) noexcept;
+
+        // Shifts the view of the canvas the given number of columns east,
+        // discarding columns on the west edge and adding blank columns.
+        void pan_east(std::size_t count);
+
+        // Shifts the view of the canvas the given number of columns west,
+        // discarding columns on the east edge and adding blank columns.
+        void pan_west(std::size_t count);
+
         // Performs whatever actions should be done after each complete change
         // of cursor position. Currently, this just marks (if the pen is down).
         void update();
@@ -164,8 +411,12 @@ namespace {
         // Tells if all cells of a given y-coordinate are currently unmarked.
         [[nodiscard]] bool blank_row(std::size_t y) const noexcept;
 
+        // Draws the rows from one y-coordinate up to (but excluding) another.
+        void draw_rows(std::ostream& out, std::size_t first,
+                       std::size_t last) const;
+
         // The grid holding the pattern recorded on the canvas, stored as rows.
-        std::deque<std::deque<bool>> rows_;
+        std::deque<Row> rows_;
 
         // The width of the canvas, in columns.
         size_t width_;
@@ -176,35 +427,51 @@ namespace {
         // The row that the cursor currently resides in.
         size_t y_;
 
-        // The symbolic representation for unmarked (background) cells.
-        char bg_;
+        // The symbolic representations for each ink, starting with ink 0 for
+        // unmarked (background) cells.
+        std::string palette_;
 
-        // The symbolic representation for marked (foreground) cells.
-        char fg_;
+        // The number of bit-planes needed to store any ink in the palette.
+        std::size_t depth_;
+
+        // The ink that marking puts in cells.
+        std::size_t ink_;
 
         // The symbolic representation for the cursor itself.
         char cur_;
 
         // The state the pen is currently in (i.e., whether it is up or down).
         Pen pen_;
+
+        // The row at the top of the viewport. Rows added or removed above it
+        // shift it, so a following viewport stays put relative to the drawing.
+        std::size_t view_top_;
+
+        // The number of rows in the viewport, or zero to display every row.
+        std::size_t view_height_;
+
+        // How the viewport moves when the cursor does.
+        Scroll scroll_;
     };
 
-    Canvas::Canvas(const std::size_t width, const char bg, const char fg,
+    Canvas::Canvas(const std::size_t width, const std::string_view palette,
                    const char cur, const Pen pen)
-        : rows_{std::deque<bool>(width)}, width_{width}, x_{width / 2u}, y_{0u},
-          bg_{bg}, fg_{fg}, cur_{cur}, pen_{pen}
+        : rows_{Row{width, depth_for_palette(size(palette))}}, width_{width},
+          x_{width / 2u}, y_{0u}, palette_{palette},
+          depth_{depth_for_palette(size(palette))}, ink_{1u}, cur_{cur},
+          pen_{pen}, view_top_{0u}, view_height_{0u}, scroll_{Scroll::center}
     {
         if (width == 0) throw std::length_error{"zero-width canvas vanishes"};
     }
 
     void Canvas::mark() noexcept
     {
-        here() = true;
+        paint_span(y_, x_, x_, ink_);
     }
 
     void Canvas::clean() noexcept
     {
-        here() = false;
+        paint_span(y_, x_, x_, 0u);
     }
 
     void Canvas::up() noexcept
@@ -286,36 +553,148 @@ namespace {
         trim_top();
     }
 
-    // Draws the pattern of foreground dots that are recorded on the canvas.
-    std::ostream& operator<<(std::ostream& out, const Canvas& canvas)
+    void Canvas::line(const int dx, const int dy)
     {
-        for (std::size_t y {0u}; y != size(canvas.rows_); ++y) {
-            for (std::size_t x {0u}; x != canvas.width_; ++x)
-                out.put(canvas.peek(x, y));
+        travel(dx, dy);
+    }
 
-            out.put('\n');
+    void Canvas::rectangle(const int dx, const int dy)
+    {
+        travel(dx, 0);
+        travel(0, dy);
+        travel(-std::ptrdiff_t{dx}, 0);
+        travel(0, -std::ptrdiff_t{dy});
+    }
+
+    void Canvas::block(const int dx, const int dy)
+    {
+        auto across = std::ptrdiff_t{dx};
+        const auto down = std::ptrdiff_t{dy < 0 ? -1 : 1};
+
+        travel(across, 0);
+
+        for (auto rows = std::abs(std::ptrdiff_t{dy}); rows != 0; --rows) {
+            travel(0, down);
+            across = -across;
+            travel(across, 0);
         }
 
-        return out;
+        if (across == dx) travel(-across, 0);
+        travel(0, -std::ptrdiff_t{dy});
+    }
+
+    void Canvas::fill()
+    {
+        // Filling with the background would leave the region blank forever.
+        if (ink_ == 0u || here() != 0u) return;
+
+        // Each seed is a cell in a run of unmarked cells that may still need
+        // filling. We fill whole runs, seeding each run that touches them above
+        // or below, so the stack stays small and cells are written by the span.
+        std::vector<std::tuple<std::size_t, std::size_t>> seeds {{x_, y_}};
+
+        const auto seed_runs = [&](const std::size_t y, const std::size_t first,
+                                   const std::size_t last) {
+            const auto& row = rows_.at(y);
+
+            for (auto x = first; x <= last; ++x) {
+                if (row.ink(x) == 0u && (x == first || row.ink(x - 1u) != 0u))
+                    seeds.emplace_back(x, y);
+            }
+        };
+
+        while (!empty(seeds)) {
+            const auto [x, y] = seeds.back();
+            seeds.pop_back();
+
+            const auto& row = rows_.at(y);
+            if (row.ink(x) != 0u) continue;
+
+            auto first = x, last = x;
+            while (first != 0u && row.ink(first - 1u) == 0u) --first;
+            while (last != width_ - 1u && row.ink(last + 1u) == 0u) ++last;
+
+            paint_span(y, first, last, ink_);
+
+            if (y != 0u) seed_runs(y - 1u, first, last);
+            if (y != size(rows_) - 1u) seed_runs(y + 1u, first, last);
+        }
     }
 
-    inline const bool& Canvas::cell(const std::size_t x,
-                                    const std::size_t y) const noexcept
+    void Canvas::ink(const int number) noexcept
     {
-        return rows_.at(y).at(x);
+        const auto last = static_cast<int>(size(palette_)) - 1;
+        ink_ = static_cast<std::size_t>(std::clamp(number, 0, last));
     }
 
-    inline bool& Canvas::cell(const std::size_t x, const std::size_t y) noexcept
+    void Canvas::set_viewport(const std::size_t height,
+                              const Scroll scroll) noexcept
     {
-        return rows_.at(y).at(x);
+        view_height_ = height;
+        scroll_ = scroll;
+        scroll_viewport();
     }
 
-    inline const bool& Canvas::here() const noexcept
+    void Canvas::scroll_viewport() noexcept
     {
-        return cell(x_, y_);
+        const auto height = size(rows_);
+
+        if (view_height_ == 0u || view_height_ >= height) {
+            view_top_ = 0u;
+            return;
+        }
+
+        if (scroll_ == Scroll::center)
+            view_top_ = y_ - std::min(y_, view_height_ / 2u);
+        else if (y_ < view_top_)
+            view_top_ = y_;
+        else if (y_ - view_top_ >= view_height_)
+            view_top_ = y_ - view_height_ + 1u;
+
+        view_top_ = std::min(view_top_, height - view_height_);
+    }
+
+    void Canvas::draw_all(std::ostream& out) const
+    {
+        draw_rows(out, 0u, size(rows_));
+    }
+
+    void Canvas::set_palette(const std::string_view palette)
+    {
+        const auto depth = depth_for_palette(size(palette));
+
+        for (auto& row : rows_) row.set_depth(depth);
+
+        palette_ = palette;
+        depth_ = depth;
+        ink_ = std::min(ink_, size(palette_) - 1u);
+    }
+
+    // Draws the pattern of foreground dots that are recorded on the canvas, in
+    // the viewport. This costs time proportional to the viewport, not canvas.
+    std::ostream& operator<<(std::ostream& out, const Canvas& canvas)
+    {
+        const auto height = size(canvas.rows_);
+
+        if (canvas.view_height_ == 0u) {
+            canvas.draw_rows(out, 0u, height);
+        } else {
+            const auto first = std::min(canvas.view_top_, height);
+            const auto last = std::min(first + canvas.view_height_, height);
+            canvas.draw_rows(out, first, last);
+        }
+
+        return out;
+    }
+
+    inline std::size_t
+    Canvas::cell(const std::size_t x, const std::size_t y) const noexcept
+    {
+        assert(x < width_);
+        return rows_.at(y).ink(x);
     }
 
-    inline bool& Canvas::here() noexcept
+    inline std::size_t Canvas::here() const noexcept
     {
         return cell(x_, y_);
     }
@@ -325,46 +704,163 @@ namespace {
     {
         if (y == y_ && x == x_) return cur_;
 
-        return cell(x, y) ? fg_ : bg_;
+        return palette_[cell(x, y)];
     }
 
     void Canvas::move_north()
     {
-        if (y_ == 0u)
-            rows_.emplace_front(width_);
-        else
+        if (y_ == 0u) {
+            rows_.emplace_front(width_, depth_);
+            ++view_top_;
+        } else {
             --y_;
+        }
     }
 
     void Canvas::move_south()
     {
-        if (++y_ == size(rows_)) rows_.emplace_back(width_);
+        if (++y_ == size(rows_)) rows_.emplace_back(width_, depth_);
     }
 
     void Canvas::move_east()
     {
-        if (x_ != width_ - 1u) {
+        if (x_ != width_ - 1u)
             ++x_;
-            return;
+        else
+            pan_east(1u);
+    }
+
+    void Canvas::move_west()
+    {
+        if (x_ != 0u)
+            --x_;
+        else
+            pan_west(1u);
+    }
+
+    void Canvas::travel(const std::ptrdiff_t dx, const std::ptrdiff_t dy)
+    {
+        if (dx == 0 && dy == 0) return;
+
+        const auto [x, y] = make_room(dx, dy);
+        if (pen_ == Pen::down) trace(x, y, dx, dy);
+
+        x_ = static_cast<std::size_t>(x + dx);
+        y_ = static_cast<std::size_t>(y + dy);
+    }
+
+    // A line only ever goes one way on each axis, so the canvas grows and pans
+    // no more than it would to reach the endpoint. Growing and panning all at
+    // once, up front, gives the same result as doing it a step at a time.
+    std::tuple<std::ptrdiff_t, std::ptrdiff_t>
+    Canvas::make_room(const std::ptrdiff_t dx, const std::ptrdiff_t dy)
+    {
+        auto x = static_cast<std::ptrdiff_t>(x_);
+        auto y = static_cast<std::ptrdiff_t>(y_);
+        const auto width = static_cast<std::ptrdiff_t>(width_);
+        const auto height = static_cast<std::ptrdiff_t>(size(rows_));
+
+        if (y + dy < 0) {
+            const auto count = static_cast<std::size_t>(-(y + dy));
+            rows_.insert(cbegin(rows_), count, Row{width_, depth_});
+            view_top_ += count;
+            y = -dy;
+        } else if (y + dy >= height) {
+            rows_.resize(static_cast<std::size_t>(y + dy + 1),
+                         Row{width_, depth_});
         }
 
-        for (auto& row : rows_) {
-            row.pop_front();
-            row.emplace_back();
+        if (x + dx < 0) {
+            pan_west(static_cast<std::size_t>(-(x + dx)));
+            x = -dx;
+        } else if (x + dx >= width) {
+            pan_east(static_cast<std::size_t>(x + dx - (width - 1)));
+            x = width - 1 - dx;
         }
+
+        return {x, y};
     }
 
-    void Canvas::move_west()
+    // Steps go one cell along the major axis (the one with more distance to
+    // cover) and zero or one cells along the minor axis, rounding to nearest.
+    // So a shallow line covers a run of cells in each row it crosses, which we
+    // mark as a span. Steps onto columns that were panned away are skipped.
+    void Canvas::trace(const std::ptrdiff_t x, const std::ptrdiff_t y,
+                       const std::ptrdiff_t dx,
+                       const std::ptrdiff_t dy) noexcept
     {
-        if (x_ != 0u) {
-            --x_;
-            return;
+        const auto width = static_cast<std::ptrdiff_t>(width_);
+        const auto run_x = std::abs(dx), run_y = std::abs(dy);
+        const auto steps = std::max(run_x, run_y);
+        const std::ptrdiff_t sign_x {dx < 0 ? -1 : 1}, sign_y {dy < 0 ? -1 : 1};
+
+        // Distance along an axis after some steps, given its total distance.
+        const auto progress = [steps](const std::ptrdiff_t step,
+                                      const std::ptrdiff_t distance) {
+            // Unsigned, so the intermediate product can't overflow.
+            const auto numerator = 2u * static_cast<std::uintmax_t>(step)
+                                      * static_cast<std::uintmax_t>(distance)
+                                 + static_cast<std::uintmax_t>(steps);
+
+            return static_cast<std::ptrdiff_t>(
+                    numerator / (2u * static_cast<std::uintmax_t>(steps)));
+        };
+
+        // Only steps onto columns still in view can mark anything. For a
+        // shallow line, that limits how many steps we need to look at.
+        auto first = std::ptrdiff_t{1}, last = steps;
+        if (run_x >= run_y) {
+            const auto west = sign_x * -x, east = sign_x * (width - 1 - x);
+            first = std::max(first, std::min(west, east));
+            last = std::min(last, std::max(west, east));
         }
 
-        for (auto& row : rows_) {
-            row.pop_back();
-            row.emplace_front();
+        std::ptrdiff_t span_y {-1}, span_first {}, span_last {};
+
+        const auto flush = [&] {
+            if (span_y < 0) return;
+
+            paint_span(static_cast<std::size_t>(span_y),
+                       static_cast<std::size_t>(span_first),
+                       static_cast<std::size_t>(span_last), ink_);
+        };
+
+        for (auto step = first; step <= last; ++step) {
+            const auto cx = x + sign_x * progress(step, run_x);
+            const auto cy = y + sign_y * progress(step, run_y);
+            if (cx < 0 || cx >= width) continue;
+
+            if (cy == span_y && cx == span_last + 1) {
+                span_last = cx;
+            } else if (cy == span_y && cx == span_first - 1) {
+                span_first = cx;
+            } else {
+                flush();
+                span_y = cy;
+                span_first = span_last = cx;
+            }
         }
+
+        flush();
+    }
+
+    inline void Canvas::paint_span(const std::size_t y, const std::size_t first,
+                                   const std::size_t last,
+                                   const std::size_t ink) noexcept
+    {
+        rows_.at(y).paint(first, last, ink);
+    }
+
+    void Canvas::pan_east(const std::size_t count)
+    {
+        const auto shift = std::min(count, width_);
+        for (auto& row : rows_) row.shift_west(shift);
+    }
+
+    void Canvas::pan_west(const std::size_t count)
+    {
+        const auto shift = std::min(count, width_);
+        for (auto& row : rows_) row.shift_east(shift);
     }
 
     inline void Canvas::update()
@@ -380,12 +876,14 @@ namespace {
                     cbegin(rows_) + static_cast<std::ptrdiff_t>(y));
 
         y_ -= y;
+        view_top_ -= std::min(view_top_, y);
     }
 
     void Canvas::remove_below(const std::size_t y) noexcept
     {
         assert(y < size(rows_));
-        rows_.resize(y + 1u);
+        rows_.erase(cbegin(rows_) + static_cast<std::ptrdiff_t>(y + 1u),
+                    cend(rows_));
     }
 
     void Canvas::trim_top() noexcept
@@ -404,16 +902,23 @@ namespace {
 
     bool Canvas::blank_row(const std::size_t y) const noexcept
     {
-        const auto& row = rows_.at(y);
-
         // Checking the whole row is simpler than having Canvas separately store
         // rows' population counts, and typical usage shouldn't produce canvases
         // big enough for this to be slow. But if other features get added that
         // would also benefit from such counts (e.g., moving the cursor to the
         // center of the smallest rectangle enclosing the whole image), it may
         // then make sense to implement it, and to use it here as well.
-        return std::none_of(cbegin(row), cend(row),
-                            [](const auto elem) { return elem; });
+        return rows_.at(y).blank();
+    }
+
+    void Canvas::draw_rows(std::ostream& out, const std::size_t first,
+                           const std::size_t last) const
+    {
+        for (auto y = first; y != last; ++y) {
+            for (std::size_t x {0u}; x != width_; ++x) out.put(peek(x, y));
+
+            out.put('\n');
+        }
     }
 
     // Abstract base class for exceptions to throw when a user-provided script
@@ -457,10 +962,36 @@ namespace {
     {
     }
 
-    // Opcodes are pointers to the public member functions of Canvas. Those
+    // Throw this when an instruction that takes operands isn't followed by
+    // operands in the form it requires.
+    class OperandError : public TranslationError {
+    public:
+        explicit OperandError(char instruction);
+    };
+
+    // Constructs an OperandError from the instruction whose operands are bad.
+    OperandError::OperandError(const char instruction)
+        : TranslationError{"Assembly error: bad or missing operands for: \""s
+                            + instruction + "\""}
+    {
+    }
+
+    // Operations are pointers to the public member functions of Canvas. Those
     // functions comprise its interface. We provide an instruction to allow the
     // user to call each of them. (But not the Canvas constructor, of course.)
-    using Opcode = void (Canvas::*)();
+    // Some take no arguments, some take a number, and some take an offset:
+    // columns east and rows south (negative for west and north).
+    using Action = void (Canvas::*)();
+    using NumberAction = void (Canvas::*)(int);
+    using OffsetAction = void (Canvas::*)(int, int);
+    using Operation = std::variant<Action, NumberAction, OffsetAction>;
+
+    // An assembled instruction: the operation to perform, together with the
+    // operands the user gave for it (if it takes any).
+    struct Opcode {
+        Operation operation;
+        std::array<int, 2> operands;
+    };
 
     // Information about an instruction that an Assembler must know.
     struct Instruction {
@@ -473,7 +1004,7 @@ namespace {
 
         // Pointer to the public member function of Canvas. This is the target
         // "format" into which symbols for the instruction are translated.
-        Opcode opcode;
+        Operation operation;
     };
 
     // Translator of one-character symbols into callable "opcodes" (which are
@@ -519,10 +1050,37 @@ namespace {
         {"move southwest",              "k1",   &Canvas::southwest},
         {"crop out Above this row",     "a",    &Canvas::crop_above},
         {"crop out Below this row",     "b",    &Canvas::crop_below},
-        {"Trim off top and bottom",     "t",    &Canvas::trim}}
+        {"Trim off top and bottom",     "t",    &Canvas::trim},
+        {"draw a line (Vector) dx,dy",  "v",    &Canvas::line},
+        {"draw a Rectangle dx,dy",      "r",    &Canvas::rectangle},
+        {"fill in a boX dx,dy",         "x",    &Canvas::block},
+        {"Flood-fill from here",        "f",    &Canvas::fill},
+        {"select Palette ink N",        "p",    &Canvas::ink}}
     {
     }
 
+    // Extracts a number from a stream, as the operand for an instruction.
+    [[nodiscard]] std::array<int, 2>
+    extract_number(std::istream& in, const char instruction)
+    {
+        int number {};
+        if (!(in >> number)) throw OperandError{instruction};
+        return {number, 0};
+    }
+
+    // Extracts a "dx,dy" offset from a stream, as operands for an instruction.
+    [[nodiscard]] std::array<int, 2>
+    extract_offset(std::istream& in, const char instruction)
+    {
+        int dx {}, dy {};
+        char comma {};
+
+        if (!(in >> dx >> comma) || comma != ',' || !(in >> dy))
+            throw OperandError{instruction};
+
+        return {dx, dy};
+    }
+
     std::vector<Opcode> Assembler::operator()(std::istream& in) const
     {
         std::vector<Opcode> ret;
@@ -538,7 +1096,14 @@ namespace {
 
             if (p == last) throw AssemblyError{ch};
 
-            ret.push_back(p->opcode);
+            Opcode opcode {p->operation, {}};
+
+            if (std::holds_alternative<NumberAction>(p->operation))
+                opcode.operands = extract_number(in, ch);
+            else if (std::holds_alternative<OffsetAction>(p->operation))
+                opcode.operands = extract_offset(in, ch);
+
+            ret.push_back(opcode);
         }
 
         return ret;
@@ -602,7 +1167,19 @@ namespace {
         std::cerr << "To repeat an instruction N times,"
                      " put \\N at the beginning of the line.\n";
         std::cerr << "If the next symbol is also a numeral,"
+                     " type a space (or tab) before it.\n";
+        std::cerr << "Write dx,dy or N right after the symbol, e.g., v5,-3"
+                     " goes 5 east and 3 north.\n";
+        std::cerr << "Again, if the next symbol is a numeral,"
                      " type a space (or tab) before it.\n\n";
+        std::cerr << "To show only N rows around the cursor, type \\vN"
+                     " (or \\fN to have them follow it).\n";
+        std::cerr << "Type \\v0 to show all rows again,"
+                     " or \\p to print the whole canvas once.\n";
+        std::cerr << "Type \\c to see how often repeated lines"
+                     " were reused without parsing.\n";
+        std::cerr << "To draw with N symbols (2, 4, or 8), type \\sN."
+                     " Then p0 erases, and p1 up to pN-1 pick inks.\n\n";
         show_quick_help();
     }
 
@@ -613,13 +1190,13 @@ namespace {
         std::exit(status);
     }
 
-    // Prompts the user and reads a response, returning it as a stringstream to
-    // facilitate parsing. Returns std::nullopt only when stdin is end-of-input.
-    [[nodiscard]] std::optional<std::istringstream> read_script_as_stream()
+    // Prompts the user and reads a response. Returns std::nullopt only when
+    // stdin is end-of-input.
+    [[nodiscard]] std::optional<std::string> read_script()
     {
         std::cerr << "\n? ";
         std::string script;
-        if (getline(std::cin, script)) return std::istringstream{script};
+        if (getline(std::cin, script)) return script;
         return std::nullopt;
     }
 
@@ -630,6 +1207,24 @@ namespace {
 
         // Designates that the program should be quit.
         constexpr struct QuitTag { } quit;
+
+        // Designates that the whole canvas should be printed, even the rows
+        // outside the viewport.
+        constexpr struct PrintTag { } print;
+
+        // Designates that the viewport should be changed to this.
+        struct Viewport {
+            std::size_t height;
+            Canvas::Scroll scroll;
+        };
+
+        // Designates that translation cache statistics should be printed.
+        constexpr struct StatsTag { } stats;
+
+        // Designates that the canvas should switch to this palette.
+        struct Palette {
+            std::string_view symbols;
+        };
     }
 
     // Extracts an integer from a stream and tries to use it as a rep-count.
@@ -640,10 +1235,45 @@ namespace {
         return reps;
     }
 
+    // Extracts an integer from a stream and tries to use it as a viewport
+    // height. Zero means no viewport (i.e., display the whole canvas).
+    [[nodiscard]] std::size_t extract_height(std::istream& in)
+    {
+        int height {};
+        if (!(in >> height) || height < 0) throw ParsingError{};
+        return static_cast<std::size_t>(height);
+    }
+
+    // Extracts an integer from a stream and tries to use it as a palette size,
+    // returning a palette with that many symbols (background first).
+    [[nodiscard]] specials::Palette extract_palette(std::istream& in)
+    {
+        int symbols {};
+        if (!(in >> symbols)) throw ParsingError{};
+
+        switch (symbols) {
+        case 2:
+            return {" *"sv};
+
+        case 4:
+            return {" *#o"sv};
+
+        case 8:
+            return {" *#o+=-."sv};
+
+        default:
+            throw ParsingError{};
+        }
+    }
+
     // Interprets leading-backslash notation, which the user may use to provide
     // a custom repetition count for the instructions int he rest of their
-    // script, or to view the full help message or quit the program.
-    [[nodiscard]] std::variant<int, specials::HelpTag, specials::QuitTag>
+    // script, to set the viewport or print the whole canvas, to change the
+    // palette, or to view the full help message or cache statistics, or quit
+    // the program.
+    [[nodiscard]] std::variant<int, specials::HelpTag, specials::QuitTag,
+                               specials::PrintTag, specials::Viewport,
+                               specials::StatsTag, specials::Palette>
     extract_reps_or_special_action(std::istream& in)
     {
         in >> std::ws;
@@ -663,6 +1293,28 @@ namespace {
                 case 'Q':
                     return specials::quit;
 
+                case 'p':
+                case 'P':
+                    return specials::print;
+
+                case 'v':
+                case 'V':
+                    return specials::Viewport{extract_height(in),
+                                              Canvas::Scroll::center};
+
+                case 'f':
+                case 'F':
+                    return specials::Viewport{extract_height(in),
+                                              Canvas::Scroll::follow};
+
+                case 'c':
+                case 'C':
+                    return specials::stats;
+
+                case 's':
+                case 'S':
+                    return extract_palette(in);
+
                 default:
                     in.unget();
                     return extract_reps(in);
@@ -674,25 +1326,153 @@ namespace {
         }
     }
 
+    // Assembled opcodes, and the number of times to execute them.
+    struct Program {
+        int reps;
+        std::vector<Opcode> code;
+    };
+
+    // What a line of script, once translated, tells us to do.
+    using Command = std::variant<Program, specials::HelpTag, specials::QuitTag,
+                                 specials::PrintTag, specials::Viewport,
+                                 specials::StatsTag, specials::Palette>;
+
+    // Parses and assembles a line of script.
+    [[nodiscard]] Command translate(const Assembler& as, std::istream& in)
+    {
+        return visit(MultiLambda{
+            [&](const int reps) -> Command { return Program{reps, as(in)}; },
+            [](const auto special) -> Command { return special; }
+        }, extract_reps_or_special_action(in));
+    }
+
+    // Translator of lines of script that remembers the most recently used
+    // lines' translations, keyed on their raw text. Users tend to send the
+    // same few lines again and again, and those needn't be parsed each time.
+    class TranslationCache {
+    public:
+        // Constructs an empty cache that translates with the given assembler
+        // and holds at most the given number of translations.
+        TranslationCache(const Assembler& as, std::size_t capacity);
+
+        // Translates a line of script, or looks up its earlier translation.
+        // If translation fails, the exception propagates and nothing is
+        // cached. The result is valid until the next call.
+        [[nodiscard]] const Command& operator()(const std::string& script);
+
+        friend std::ostream& operator<<(std::ostream& out,
+                                        const TranslationCache& cache);
+
+    private:
+        // A line of script and what it translated to.
+        struct Entry {
+            std::string script;
+            Command command;
+        };
+
+        // The assembler to translate with.
+        const Assembler& as_;
+
+        // The most translations we hold on to at once.
+        std::size_t capacity_;
+
+        // The translations, from most to least recently used.
+        std::list<Entry> entries_;
+
+        // Where each line's translation is. Keys view the entries' scripts.
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+
+        // The number of lookups that found an earlier translation.
+        std::size_t hits_;
+
+        // The number of lookups that had to translate the line.
+        std::size_t misses_;
+    };
+
+    TranslationCache::TranslationCache(const Assembler& as,
+                                       const std::size_t capacity)
+        : as_{as}, capacity_{capacity}, hits_{0u}, misses_{0u}
+    {
+        if (capacity == 0u)
+            throw std::length_error{"zero-capacity cache can't return entries"};
+    }
+
+    const Command& TranslationCache::operator()(const std::string& script)
+    {
+        if (const auto p = index_.find(script); p != end(index_)) {
+            ++hits_;
+            entries_.splice(begin(entries_), entries_, p->second);
+            return p->second->command;
+        }
+
+        ++misses_;
+        std::istringstream in {script};
+        auto command = translate(as_, in);
+
+        if (size(entries_) == capacity_) {
+            index_.erase(entries_.back().script);
+            entries_.pop_back();
+        }
+
+        entries_.push_front({script, std::move(command)});
+        index_.emplace(entries_.front().script, begin(entries_));
+        return entries_.front().command;
+    }
+
+    // Displays the cache's hit and miss counts and how full it is.
+    std::ostream& operator<<(std::ostream& out, const TranslationCache& cache)
+    {
+        return out << "Cache: " << cache.hits_ << " hits, " << cache.misses_
+                   << " misses, " << size(cache.entries_) << " of "
+                   << cache.capacity_ << " entries used";
+    }
+
     // Execute assembled opcodes on a canvas a specified number of times.
-    void execute(Canvas& canvas, const std::vector<Opcode>& code, int reps)
+    void execute(Canvas& canvas, const Program& program)
     {
-        while (reps-- != 0)
-            for (const auto f : code) (canvas.*f)();
+        for (auto reps = program.reps; reps != 0; --reps) {
+            for (const auto& opcode : program.code) {
+                const auto& args = opcode.operands;
 
+                visit(MultiLambda{
+                    [&](const Action f) { (canvas.*f)(); },
+                    [&](const NumberAction f) { (canvas.*f)(args[0]); },
+                    [&](const OffsetAction f) { (canvas.*f)(args[0], args[1]); }
+                }, opcode.operation);
+            }
+        }
+
+        canvas.scroll_viewport();
         std::cout << canvas;
     }
 
     // Main loop. Runs the user's commands. Displays the canvas except on error.
     void repl(const Assembler& as, Canvas& canvas)
     {
-        while (auto in = read_script_as_stream()) {
+        // Enough for the lines a user or script is likely to be repeating.
+        constexpr std::size_t cache_capacity {256u};
+
+        TranslationCache translate_cached {as, cache_capacity};
+
+        while (const auto script = read_script()) {
             try {
                 visit(MultiLambda{
-                    [&](const int reps) { execute(canvas, as(*in), reps); },
+                    [&](const Program& program) { execute(canvas, program); },
                     [&](specials::HelpTag) { show_help(as); },
-                    [](specials::QuitTag) { quit(EXIT_SUCCESS, "Bye!"); }
-                }, extract_reps_or_special_action(*in));
+                    [](specials::QuitTag) { quit(EXIT_SUCCESS, "Bye!"); },
+                    [&](specials::PrintTag) { canvas.draw_all(std::cout); },
+                    [&](const specials::Viewport viewport) {
+                        canvas.set_viewport(viewport.height, viewport.scroll);
+                        std::cout << canvas;
+                    },
+                    [&](specials::StatsTag) {
+                        std::cerr << translate_cached << '\n';
+                    },
+                    [&](const specials::Palette palette) {
+                        canvas.set_palette(palette.symbols);
+                        std::cout << canvas;
+                    }
+                }, translate_cached(*script));
             }
             catch (const TranslationError& e) {
                 std::cerr << e.what() << '\n';